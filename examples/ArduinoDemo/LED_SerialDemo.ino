@@ -9,10 +9,19 @@
 
 #define RESOURCE_ID_FOR_SWITCH 0x01
 
+/* Every queued message costs a full SMoSObject_t (about 270 bytes on AVR), so the
+   queue is kept to a single slot to fit a 2 KB board such as the Uno. */
+#define ADMISSION_QUEUE_DEPTH 1
+#define ADMISSION_BUCKET_CAPACITY 4
+#define ADMISSION_REFILL_PER_SECOND 10
+#define ADMISSION_CON_TOKEN_RESERVE 1
+
 static SMoSObject_t smosObject;
 static char hexString[SMOS_HEX_STRING_MAX_LENGTH + 1]; /* NULL terminated string */
 static uint16_t hexStringLength;
 static bool switchIsOn = false;
+static SMoSAdmissionPeer_t serialPeer;
+static SMoSObject_t admissionQueue[ADMISSION_QUEUE_DEPTH];
 
 static void ResetBuiltInLedResource(void)
 {
@@ -46,111 +55,113 @@ static bool IsBuiltInLedOn(void)
    return switchIsOn;
 }
 
-static void ProcessConfirmableRequest(SMoSObject_t const * const reqMessage)
+static void SendResponse(SMoSObject_t const * const respMessage)
 {
    char respHexString[SMOS_HEX_STRING_MAX_LENGTH + 1]; /* NULL terminated string */
-   SMoSObject_t respMessage;
 
    memset(respHexString, 0, sizeof(respHexString[0]) * (SMOS_HEX_STRING_MAX_LENGTH + 1));
-   memset(&respMessage, 0, sizeof(respMessage));
+
+   if (smos_EncodeToHexString(respMessage, respHexString) == SMOS_RESULT_SUCCESS)
+   {
+      Serial.println(respHexString);
+   }
+   else
+   {
+      Serial.println("Failed to encode hex string");
+   }
+}
+
+static void ProcessConfirmableRequest(SMoSObject_t * const message)
+{
+   /* RAM is tight on small boards, so the response is built in place over the request.
+      Take what we need from the request first. */
+   uint8_t messageId = message->messageId;
+   uint8_t resourceIndex = message->resourceIndex;
+   uint8_t byteCount = message->byteCount;
+   bool ledOn = (bool)(message->payload[0]);
+   SMoSCodeDetailRequest_e codeDetailRequest = message->codeDetailRequest;
+
+   memset(message, 0, sizeof(*message));
 
    /* Populate response fields that are common. */
-      respMessage.version = SMOS_VERSION_CURRENT;
-      respMessage.lastBlockFlag = true;
-      respMessage.messageId = reqMessage->messageId;
-      respMessage.resourceIndex = reqMessage->resourceIndex;
-      respMessage.contextType = SMOS_CONTEXT_TYPE_ACK;
+      message->version = SMOS_VERSION_CURRENT;
+      message->lastBlockFlag = true;
+      message->messageId = messageId;
+      message->resourceIndex = resourceIndex;
+      message->contextType = SMOS_CONTEXT_TYPE_ACK;
 
    /* The only resource is the switch. Anything else, send a resource not found. */
-   if (reqMessage->resourceIndex != RESOURCE_ID_FOR_SWITCH)
+   if (resourceIndex != RESOURCE_ID_FOR_SWITCH)
    {
-      respMessage.codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
-      respMessage.codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_NOT_FOUND;
+      message->codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
+      message->codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_NOT_FOUND;
 
-      if (smos_EncodeToHexString(&respMessage, respHexString) == SMOS_RESULT_SUCCESS)
-      {
-         Serial.println(respHexString);
-      }
-      else
-      {
-         Serial.println("Failed to encode hex string");
-      }
+      SendResponse(message);
 
       return;
    }
 
-   switch (reqMessage->codeDetailRequest)
+   switch (codeDetailRequest)
    {
       case SMOS_CODE_DETAIL_GET:
          /* Note that we are ignoring observe request for now. Just return direct queries response. */
-         respMessage.byteCount = 0x01;
-         respMessage.codeClass = SMOS_CODE_CLASS_RESP_SUCCESS;
-         respMessage.codeDetailResponse = SMOS_CODE_DETAIL_SUCCESS_CONTENT;
-         respMessage.payload[0] = (uint8_t)IsBuiltInLedOn();
+         message->byteCount = 0x01;
+         message->codeClass = SMOS_CODE_CLASS_RESP_SUCCESS;
+         message->codeDetailResponse = SMOS_CODE_DETAIL_SUCCESS_CONTENT;
+         message->payload[0] = (uint8_t)IsBuiltInLedOn();
 
-         if (smos_EncodeToHexString(&respMessage, respHexString) == SMOS_RESULT_SUCCESS)
-         {
-            Serial.println(respHexString);
-         }
-         else
-         {
-            Serial.println("Failed to encode hex string");
-         }
+         SendResponse(message);
          break;
 
       case SMOS_CODE_DETAIL_POST:
       case SMOS_CODE_DETAIL_DELETE:
-         respMessage.codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
-         respMessage.codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_METHOD_NOT_ALLOWED;
+         message->codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
+         message->codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_METHOD_NOT_ALLOWED;
 
-         if (smos_EncodeToHexString(&respMessage, respHexString) == SMOS_RESULT_SUCCESS)
-         {
-            Serial.println(respHexString);
-         }
-         else
-         {
-            Serial.println("Failed to encode hex string");
-         }
+         SendResponse(message);
          break;
 
       case SMOS_CODE_DETAIL_PUT:
          /* Update the built-in LED based on the request. */
-         if (reqMessage->byteCount == 0)
+         if (byteCount == 0)
          {
-            respMessage.codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
-            respMessage.codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_BAD_REQUEST;
-
-            if (smos_EncodeToHexString(&respMessage, respHexString) == SMOS_RESULT_SUCCESS)
-            {
-               Serial.println(respHexString);
-            }
-            else
-            {
-               Serial.println("Failed to encode hex string");
-            }
+            message->codeClass = SMOS_CODE_CLASS_RESP_CLIENT_ERROR;
+            message->codeDetailResponse = SMOS_CODE_DETAIL_CLIENT_ERROR_BAD_REQUEST;
+
+            SendResponse(message);
 
             return;
          }
 
-         SetBuiltInLedState((bool)(reqMessage->payload[0]));
+         SetBuiltInLedState(ledOn);
 
-         respMessage.codeClass = SMOS_CODE_CLASS_RESP_SUCCESS;
-         respMessage.codeDetailResponse = SMOS_CODE_DETAIL_SUCCESS_CHANGED;
+         message->codeClass = SMOS_CODE_CLASS_RESP_SUCCESS;
+         message->codeDetailResponse = SMOS_CODE_DETAIL_SUCCESS_CHANGED;
 
-         if (smos_EncodeToHexString(&respMessage, respHexString) == SMOS_RESULT_SUCCESS)
-         {
-            Serial.println(respHexString);
-         }
-         else
-         {
-            Serial.println("Failed to encode hex string");
-         }
+         SendResponse(message);
 
          break;
    }
 }
 
-static void ProcessSMoSMessage(SMoSObject_t const * const message)
+static void AdmitSMoSMessage(SMoSObject_t * const message)
+{
+   switch (smos_AdmissionOffer(&serialPeer, message, millis(), message))
+   {
+      case SMOS_ADMISSION_RESULT_REJECTED:
+         /* Overloaded, answer with service unavailable without running the handler.
+            The response was written over the request. */
+         SendResponse(message);
+         break;
+
+      case SMOS_ADMISSION_RESULT_ADMITTED:
+      case SMOS_ADMISSION_RESULT_SHED:
+      default:
+         break;
+   }
+}
+
+static void ProcessSMoSMessage(SMoSObject_t * const message)
 {
    /* Currently we only cared about confirmable requests (i.e expects a
       response from the Arduino). */
@@ -161,6 +172,66 @@ static void ProcessSMoSMessage(SMoSObject_t const * const message)
    }
 }
 
+static void ProcessSerialChar(char c)
+{
+   /* If we get a start code, we will reset the hex string and start over. */
+   if (smos_IsStartCode(c))
+   {
+      Serial.println("");
+      ResetHexString();
+      hexString[hexStringLength] = c;
+      hexStringLength++;
+      hexString[hexStringLength] = 0;
+
+      return;
+   }
+
+   /* We have already started processing a hex string so carry on processing it. */
+   if (hexStringLength != 0)
+   {
+      SMoSResult_e result;
+      uint16_t expectedHexStringLength = 0;
+
+      hexString[hexStringLength] = c;
+      hexStringLength++;
+      hexString[hexStringLength] = 0;
+
+      /* We are reading data over the serial link, char by char. So make sure we read
+         the whole string before processing it. */
+      if (hexStringLength < smos_GetMinimumHexStringLength() ||
+          smos_GetExpectedHexStringLength(hexString, hexStringLength, &expectedHexStringLength) != SMOS_RESULT_SUCCESS ||
+          hexStringLength < expectedHexStringLength)
+      {
+         return;
+      }
+
+      result = smos_DecodeFromHexString(hexString, hexStringLength, &smosObject);
+
+      switch (result)
+      {
+         case SMOS_RESULT_ERROR_NOT_MIN_LENGTH_HEX_STRING:
+         case SMOS_RESULT_ERROR_HEX_STRING_INCOMPLETE:
+            /* String not long enough, do nothing for now. */
+            Serial.println("Incomplete hex string");
+            break;
+
+         case SMOS_RESULT_SUCCESS:
+            AdmitSMoSMessage(&smosObject);
+            ResetHexString();
+            break;
+
+         case SMOS_RESULT_ERROR_NULL_POINTER:
+         case SMOS_RESULT_ERROR_HEX_STRING_INVALID_STARTCODE:
+         case SMOS_RESULT_ERROR_HEX_STRING_INVALID_CHECKSUM:
+         default:
+            /* We received a bad hex string. There's nothing we can do about it. */
+            ResetHexString();
+            Serial.println("Failed to decode hex string");
+            break;
+      }
+   }
+}
+
 
 /******************************
  * Arduino Setup() and Loop() *
@@ -168,75 +239,42 @@ static void ProcessSMoSMessage(SMoSObject_t const * const message)
 
 void setup()
 {
+   SMoSResult_e admissionInitResult;
+
    memset(&smosObject, 0, sizeof(smosObject));
    ResetHexString();
    ResetBuiltInLedResource();
+   admissionInitResult = smos_AdmissionInit(&serialPeer,
+                                            admissionQueue,
+                                            ADMISSION_QUEUE_DEPTH,
+                                            ADMISSION_BUCKET_CAPACITY,
+                                            ADMISSION_REFILL_PER_SECOND,
+                                            ADMISSION_CON_TOKEN_RESERVE,
+                                            millis());
 
    Serial.begin(9600);
    Serial.println("Begin SMoS Demo");
+
+   if (admissionInitResult != SMOS_RESULT_SUCCESS)
+   {
+      Serial.println("Failed to initialise admission control");
+   }
 }
 
 void loop()
 {
-   if (Serial.available())
+   /* Decode everything the serial link has buffered, rather than one char per pass,
+      so admitted messages can back up behind the handler. Once the queue is full,
+      stop reading and leave the rest in the serial receive buffer. */
+   while (Serial.available() && !smos_AdmissionShouldPauseReads(&serialPeer))
    {
-      char c = Serial.read();
-
-      /* If we get a start code, we will reset the hex string and start over. */
-      if (smos_IsStartCode(c))
-      {
-         Serial.println("");
-         ResetHexString();
-         hexString[hexStringLength] = c;
-         hexStringLength++;
-         hexString[hexStringLength] = 0;
-
-         return;
-      }
-
-      /* We have already started processing a hex string so carry on processing it. */
-      if (hexStringLength != 0)
-      {
-         SMoSResult_e result;
-         uint16_t expectedHexStringLength = 0;
-
-         hexString[hexStringLength] = c;
-         hexStringLength++;
-         hexString[hexStringLength] = 0;
-
-         /* We are reading data over the serial link, char by char. So make sure we read
-            the whole string before processing it. */
-         if (hexStringLength < smos_GetMinimumHexStringLength() ||
-             smos_GetExpectedHexStringLength(hexString, hexStringLength, &expectedHexStringLength) != SMOS_RESULT_SUCCESS ||
-             hexStringLength < expectedHexStringLength)
-         {
-            return;
-         }
-
-         result = smos_DecodeFromHexString(hexString, hexStringLength, &smosObject);
+      ProcessSerialChar(Serial.read());
+   }
 
-         switch (result)
-         {
-            case SMOS_RESULT_ERROR_NOT_MIN_LENGTH_HEX_STRING:
-            case SMOS_RESULT_ERROR_HEX_STRING_INCOMPLETE:
-               /* String not long enough, do nothing for now. */
-               Serial.println("Incomplete hex string");
-               break;
-
-            case SMOS_RESULT_SUCCESS:
-               ProcessSMoSMessage(&smosObject);
-               ResetHexString();
-               break;
-
-            case SMOS_RESULT_ERROR_NULL_POINTER:
-            case SMOS_RESULT_ERROR_HEX_STRING_INVALID_STARTCODE:
-            case SMOS_RESULT_ERROR_HEX_STRING_INVALID_CHECKSUM:
-            default:
-               /* We received a bad hex string. There's nothing we can do about it. */
-               ResetHexString();
-               Serial.println("Failed to decode hex string");
-               break;
-         }
-      }
+   /* Handle at most one admitted message per pass. smosObject is free to reuse here,
+      the admission queue keeps its own copy of every admitted message. */
+   if (smos_AdmissionDequeue(&serialPeer, &smosObject))
+   {
+      ProcessSMoSMessage(&smosObject);
    }
 }
@@ -4,6 +4,7 @@
 /* HEADER INCLUDES */
 #include "smosEncoder.h"
 #include "smosDecoder.h"
+#include "smosAdmission.h"
 
 /* FUNCTION DECLARATIONS */
 
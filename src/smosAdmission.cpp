@@ -0,0 +1,205 @@
+/**
+ * SMoS - Library for encoding and decoding of SMoS messages.
+ *        Please refer to https://github.com/ChrisDinhNZ/SMoS for more details.
+ * Created by Chris Dinh, 2020
+ * Released under MIT license
+ * 
+ * The library was derived from LibGIS IHex implementation (https://github.com/vsergeev/libGIS)
+ */
+
+/* HEADER INCLUDES */
+#include "smosAdmission.h"
+
+/* CONSTANT DECLARATIONS */
+#define MS_PER_SECOND 1000UL
+
+/* FUNCTION DECLARATIONS */
+static bool smos_AdmissionIsRateLimited(const SMoSAdmissionPeer_t *peer);
+static void smos_AdmissionRefill(SMoSAdmissionPeer_t *peer, const uint32_t nowMs);
+static void smos_AdmissionCreateServiceUnavailable(const SMoSObject_t *request, SMoSObject_t *response);
+
+/* VARIABLE DECLARATIONS */
+
+/* FUNCTION DEFINITIONS */
+
+SMoSResult_e smos_AdmissionInit(SMoSAdmissionPeer_t *peer,
+                                SMoSObject_t *queue,
+                                const uint16_t queueDepth,
+                                const uint16_t bucketCapacity,
+                                const uint16_t refillPerSecond,
+                                const uint16_t conTokenReserve,
+                                const uint32_t nowMs)
+{
+   if (peer == NULL || queue == NULL)
+   {
+      return SMOS_RESULT_ERROR_NULL_POINTER;
+   }
+
+   if (queueDepth == 0)
+   {
+      return SMOS_RESULT_ERROR_INVALID_ARGUMENT;
+   }
+
+   memset(peer, 0, sizeof(*peer));
+
+   peer->queue = queue;
+   peer->queueDepth = queueDepth;
+
+   /* Keep the last queue slot for confirmable requests, unless there is only one. */
+   peer->nonQueueLimit = queueDepth > 1 ? queueDepth - 1 : queueDepth;
+
+   /* A zero capacity or refill rate disables rate limiting, only the queue applies.
+      Any other rate a uint16_t can hold is refilled exactly, see smos_AdmissionRefill(). */
+   if (bucketCapacity != 0 && refillPerSecond != 0)
+   {
+      peer->bucketCapacity = bucketCapacity;
+      peer->refillPerSecond = refillPerSecond;
+      peer->tokens = bucketCapacity;
+
+      /* Always leave at least one token that non confirmable messages can use. */
+      peer->conTokenReserve = conTokenReserve < bucketCapacity ? conTokenReserve : bucketCapacity - 1;
+   }
+
+   peer->lastRefillMs = nowMs;
+
+   return SMOS_RESULT_SUCCESS;
+}
+
+SMoSAdmissionResult_e smos_AdmissionOffer(SMoSAdmissionPeer_t *peer,
+                                          const SMoSObject_t *message,
+                                          const uint32_t nowMs,
+                                          SMoSObject_t *response)
+{
+   /* Note that response may point to the same object as message, so the caller
+      does not need a second SMoSObject_t on the stack. */
+   uint16_t queueLimit, tokenReserve;
+   bool isConfirmableRequest;
+
+   if (peer == NULL || message == NULL || response == NULL)
+   {
+      return SMOS_ADMISSION_RESULT_ERROR_NULL_POINTER;
+   }
+
+   isConfirmableRequest = smos_IsConfirmableRequest(message);
+
+   /* Non confirmable messages are shed first. They can't use the reserved tokens or
+      the last queue slot, which are kept for requests that a client is waiting on. */
+   queueLimit = isConfirmableRequest ? peer->queueDepth : peer->nonQueueLimit;
+   tokenReserve = isConfirmableRequest ? 0 : peer->conTokenReserve;
+
+   if (smos_AdmissionIsRateLimited(peer))
+   {
+      smos_AdmissionRefill(peer, nowMs);
+   }
+
+   if ((smos_AdmissionIsRateLimited(peer) && peer->tokens <= tokenReserve) ||
+       peer->queueCount >= queueLimit)
+   {
+      if (isConfirmableRequest)
+      {
+         /* Tell the client straight away rather than leaving it to retransmit. */
+         smos_AdmissionCreateServiceUnavailable(message, response);
+         peer->rejectedCount++;
+
+         return SMOS_ADMISSION_RESULT_REJECTED;
+      }
+
+      peer->shedCount++;
+
+      return SMOS_ADMISSION_RESULT_SHED;
+   }
+
+   if (smos_AdmissionIsRateLimited(peer))
+   {
+      peer->tokens--;
+   }
+
+   memcpy(&peer->queue[(peer->queueHead + peer->queueCount) % peer->queueDepth],
+          message,
+          sizeof(*message));
+   peer->queueCount++;
+
+   return SMOS_ADMISSION_RESULT_ADMITTED;
+}
+
+bool smos_AdmissionDequeue(SMoSAdmissionPeer_t *peer, SMoSObject_t *message)
+{
+   if (peer == NULL || message == NULL || peer->queueCount == 0)
+   {
+      return false;
+   }
+
+   memcpy(message, &peer->queue[peer->queueHead], sizeof(*message));
+   peer->queueHead = (peer->queueHead + 1) % peer->queueDepth;
+   peer->queueCount--;
+
+   return true;
+}
+
+bool smos_AdmissionShouldPauseReads(const SMoSAdmissionPeer_t *peer)
+{
+   if (peer == NULL)
+   {
+      return false;
+   }
+
+   /* Leave bytes in the link's receive buffer while the queue is full, instead of
+      reading frames we have nowhere to put. */
+   return peer->queueCount >= peer->queueDepth;
+}
+
+static bool smos_AdmissionIsRateLimited(const SMoSAdmissionPeer_t *peer)
+{
+   return peer->bucketCapacity != 0;
+}
+
+static void smos_AdmissionRefill(SMoSAdmissionPeer_t *peer, const uint32_t nowMs)
+{
+   uint32_t elapsedMs, refill;
+
+   /* Unsigned subtraction keeps this correct across millis() wrap around. */
+   elapsedMs = nowMs - peer->lastRefillMs;
+   peer->lastRefillMs = nowMs;
+
+   if (elapsedMs > MS_PER_SECOND * 60UL)
+   {
+      /* Avoid overflow after a long idle period, the bucket is full by now anyway. */
+      peer->tokens = peer->bucketCapacity;
+      peer->refillRemainder = 0;
+      return;
+   }
+
+   /* Work in thousandths of a token and carry the partial token over to the next
+      call, so nothing is lost or counted twice whatever the refill rate. This can't
+      overflow, 60000 ms * 65535 tokens/s + 999 still fits in 32 bits. */
+   refill = elapsedMs * peer->refillPerSecond + peer->refillRemainder;
+   peer->refillRemainder = (uint16_t)(refill % MS_PER_SECOND);
+   refill /= MS_PER_SECOND;
+
+   if ((uint32_t)peer->tokens + refill >= peer->bucketCapacity)
+   {
+      peer->tokens = peer->bucketCapacity;
+      peer->refillRemainder = 0;
+   }
+   else
+   {
+      peer->tokens += (uint16_t)refill;
+   }
+}
+
+static void smos_AdmissionCreateServiceUnavailable(const SMoSObject_t *request, SMoSObject_t *response)
+{
+   /* Take what we need from the request first, response may overwrite it. */
+   uint8_t messageId = request->messageId;
+   uint8_t resourceIndex = request->resourceIndex;
+
+   memset(response, 0, sizeof(*response));
+
+   response->version = SMOS_VERSION_CURRENT;
+   response->contextType = SMOS_CONTEXT_TYPE_ACK;
+   response->lastBlockFlag = true;
+   response->codeClass = SMOS_CODE_CLASS_RESP_SERVER_ERROR;
+   response->codeDetailResponse = SMOS_CODE_DETAIL_SERVER_ERROR_SERVICE_UNAVAILABLE;
+   response->messageId = messageId;
+   response->resourceIndex = resourceIndex;
+}
@@ -0,0 +1,25 @@
+#ifndef SMOS_ADMISSION_H
+#define SMOS_ADMISSION_H
+
+/* HEADER INCLUDES */
+#include "smosCommon.h"
+
+/* FUNCTION DECLARATIONS */
+SMoSResult_e smos_AdmissionInit(SMoSAdmissionPeer_t *peer,
+                                SMoSObject_t *queue,
+                                const uint16_t queueDepth,
+                                const uint16_t bucketCapacity,
+                                const uint16_t refillPerSecond,
+                                const uint16_t conTokenReserve,
+                                const uint32_t nowMs);
+
+SMoSAdmissionResult_e smos_AdmissionOffer(SMoSAdmissionPeer_t *peer,
+                                          const SMoSObject_t *message,
+                                          const uint32_t nowMs,
+                                          SMoSObject_t *response);
+
+bool smos_AdmissionDequeue(SMoSAdmissionPeer_t *peer, SMoSObject_t *message);
+
+bool smos_AdmissionShouldPauseReads(const SMoSAdmissionPeer_t *peer);
+
+#endif /* #define SMOS_ADMISSION_H */
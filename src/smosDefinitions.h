@@ -179,7 +179,8 @@ typedef enum SMoSResult_e
    SMOS_RESULT_ERROR_NOT_MIN_LENGTH_HEX_STRING,
    SMOS_RESULT_ERROR_HEX_STRING_INCOMPLETE,
    SMOS_RESULT_ERROR_HEX_STRING_INVALID_STARTCODE,
-   SMOS_RESULT_ERROR_HEX_STRING_INVALID_CHECKSUM
+   SMOS_RESULT_ERROR_HEX_STRING_INVALID_CHECKSUM,
+   SMOS_RESULT_ERROR_INVALID_ARGUMENT
 };
 
 typedef enum SMoSPduFields_e
@@ -198,6 +199,14 @@ typedef enum SMoSPduFields_e
    SMOS_PDU_FIELD_IDENTIFIER_PAYLOAD
 };
 
+typedef enum SMoSAdmissionResult_e
+{
+   SMOS_ADMISSION_RESULT_ADMITTED,
+   SMOS_ADMISSION_RESULT_SHED,
+   SMOS_ADMISSION_RESULT_REJECTED,
+   SMOS_ADMISSION_RESULT_ERROR_NULL_POINTER
+} SMoSAdmissionResult_e;
+
 /**
  * Structure to hold the fields of an SMoS message.
  */
@@ -218,4 +227,27 @@ typedef struct SMoSObject_t
    uint8_t payload[SMOS_PAYLOAD_MAX_BYTE_COUNT];
 };
 
+/**
+ * Structure to hold the admission control state of a single peer (i.e. one link).
+ * Incoming messages are rate limited by a token bucket and held in a bounded queue
+ * until the application is ready to handle them. The queue storage is supplied by
+ * the caller through smos_AdmissionInit().
+ */
+typedef struct SMoSAdmissionPeer_t
+{
+   uint16_t tokens;
+   uint16_t bucketCapacity;
+   uint16_t refillPerSecond;
+   uint16_t conTokenReserve;
+   uint32_t lastRefillMs;
+   uint16_t refillRemainder;
+   SMoSObject_t *queue;
+   uint16_t queueDepth;
+   uint16_t nonQueueLimit;
+   uint16_t queueHead;
+   uint16_t queueCount;
+   uint16_t shedCount;
+   uint16_t rejectedCount;
+} SMoSAdmissionPeer_t;
+
 #endif /* #define SMOS_DEFINITONS_H */